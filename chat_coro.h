@@ -0,0 +1,137 @@
+// chat_coro.h - C++20 awaitable API over ChatSession
+//
+//   ChatTask RunBot(SessionLoop& loop) {
+//       ChatClient client(loop);
+//       if (!(co_await client.Connect("localhost:5000")).ok) co_return;
+//       if (!(co_await client.Login("bot", "secret")).ok) co_return;
+//       for (;;) {
+//           ChatEvent event = co_await client.NextEvent();
+//           if (event.type == EVENT_CLOSED) break;
+//           if (event.type == EVENT_MESSAGE) co_await client.Send(event.partner, "echo: " + event.text);
+//       }
+//   }
+//
+// Coroutines resume on the SessionLoop thread, so any number of them can run
+// on one thread next to each other and next to callback-based sessions.
+// Without compiler coroutine support this header declares nothing, so
+// C++17 builds that include it are unaffected.
+#pragma once
+
+#include "chat_session.h"
+
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+struct ChatResult {
+    bool ok;
+    std::string error;
+};
+
+// Fire-and-forget coroutine: starts immediately and frees itself when done
+struct ChatTask {
+    struct promise_type {
+        ChatTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Suspends until a ChatSession callback fires. ChatSession calls every
+// callback exactly once, possibly before `start` returns; in that case the
+// coroutine simply carries on without suspending.
+template <typename Result, typename Callback>
+class ChatAwaiter {
+public:
+    explicit ChatAwaiter(std::function<void(Callback)> start)
+        : start(std::move(start)), completed(false), suspended(false) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        waiting = handle;
+        start(Callback(Receiver{ this }));
+        if (completed) return false;
+        suspended = true;
+        return true;
+    }
+
+    Result await_resume() { return std::move(result); }
+
+private:
+    struct Receiver {
+        ChatAwaiter* awaiter;
+
+        void operator()(bool ok, const std::string& error) const { Finish(ChatResult{ ok, error }); }
+        void operator()(const ChatEvent& event) const { Finish(event); }
+
+        template <typename Value>
+        void Finish(const Value& value) const {
+            if constexpr (std::is_convertible_v<const Value&, Result>) awaiter->result = value;
+            awaiter->completed = true;
+            if (awaiter->suspended) awaiter->waiting.resume();
+        }
+    };
+
+    std::function<void(Callback)> start;
+    std::coroutine_handle<> waiting;
+    Result result{};
+    bool completed;
+    bool suspended;
+};
+
+typedef ChatAwaiter<ChatResult, ChatSession::Completion> ChatResultAwaiter;
+typedef ChatAwaiter<ChatEvent, ChatSession::EventHandler> ChatEventAwaiter;
+
+// Sending never waits for the network (ChatSession buffers it), so this
+// awaiter is ready at once; it exists so every client call reads the same.
+struct ChatSendAwaiter {
+    bool sent;
+
+    bool await_ready() const noexcept { return true; }
+    void await_suspend(std::coroutine_handle<>) const noexcept {}
+    bool await_resume() const noexcept { return sent; }
+};
+
+class ChatClient {
+public:
+    explicit ChatClient(SessionLoop& loop) : session(loop) {}
+
+    ChatResultAwaiter Connect(std::string address) {
+        return ChatResultAwaiter([this, address](ChatSession::Completion done) {
+            session.Connect(address, done);
+        });
+    }
+
+    // mode is "login" or "register"
+    ChatResultAwaiter Login(std::string username, std::string password, std::string mode = "login") {
+        return ChatResultAwaiter([this, username, password, mode](ChatSession::Completion done) {
+            session.Login(mode, username, password, done);
+        });
+    }
+
+    // Yields EVENT_CLOSED once the connection is gone
+    ChatEventAwaiter NextEvent() {
+        return ChatEventAwaiter([this](ChatSession::EventHandler handler) {
+            session.NextEvent(handler);
+        });
+    }
+
+    ChatSendAwaiter Send(const std::string& conversation, const std::string& text) {
+        return ChatSendAwaiter{ session.Send(conversation, text) };
+    }
+
+    // Commands, the session state and Close() live on the session itself
+    ChatSession& Session() { return session; }
+
+private:
+    ChatSession session;
+};
+
+#endif  // __cpp_impl_coroutine
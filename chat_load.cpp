@@ -0,0 +1,100 @@
+// chat_load.cpp - Drives many chat sessions from one thread for load testing
+//   g++ -std=c++17 chat_load.cpp -o chat_load -lws2_32
+//   chat_load <server[:port]> <sessions> <login|register> <password> [seconds]
+// Session i uses the username "loadbot<i>". Each one connects, logs in and
+// asks for the user list; the tool reports how long that took and how many
+// server events arrived before the time is up.
+#pragma comment(lib, "ws2_32.lib")
+
+#include "chat_session.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+struct LoadStats {
+    size_t connected = 0;
+    size_t loggedIn = 0;
+    size_t failed = 0;
+    size_t events = 0;
+    size_t closed = 0;
+};
+
+int main(int argc, char** argv) {
+    if (argc < 5) {
+        printf("usage: %s <server[:port]> <sessions> <login|register> <password> [seconds]\n", argv[0]);
+        return 1;
+    }
+    string address = argv[1];
+    size_t count = (size_t)atoi(argv[2]);
+    string mode = argv[3];
+    string password = argv[4];
+    UINT seconds = argc > 5 ? (UINT)atoi(argv[5]) : 10;
+
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        printf("Failed to initialize Winsock\n");
+        return 1;
+    }
+
+    SessionLoop loop;
+    LoadStats stats;
+    Clock::time_point start = Clock::now();
+    double lastLoginMs = 0;
+
+    vector<unique_ptr<ChatSession>> sessions;
+    for (size_t i = 0; i < count; i++) {
+        sessions.push_back(unique_ptr<ChatSession>(new ChatSession(loop)));
+    }
+
+    function<void(ChatSession*)> listen = [&](ChatSession* session) {
+        session->NextEvent([&, session](const ChatEvent& event) {
+            if (event.type == EVENT_CLOSED) {
+                stats.closed++;
+                return;
+            }
+            stats.events++;
+            listen(session);
+        });
+    };
+
+    for (size_t i = 0; i < count; i++) {
+        ChatSession* session = sessions[i].get();
+        string username = "loadbot" + to_string(i);
+        session->Connect(address, [&, session, username](bool ok, const string& error) {
+            if (!ok) {
+                stats.failed++;
+                printf("%s: connect failed: %s\n", username.c_str(), error.c_str());
+                return;
+            }
+            stats.connected++;
+            session->Login(mode, username, password, [&, session, username](bool ok, const string& error) {
+                if (!ok) {
+                    stats.failed++;
+                    printf("%s: %s failed: %s\n", username.c_str(), mode.c_str(), error.c_str());
+                    return;
+                }
+                stats.loggedIn++;
+                lastLoginMs = chrono::duration<double, milli>(Clock::now() - start).count();
+                listen(session);
+                session->ListUsers();
+            });
+        });
+    }
+
+    loop.StartTimer(seconds * 1000, [&]() { loop.Stop(); });
+    loop.Run();
+
+    printf("sessions: %zu, connected: %zu, logged in: %zu, failed: %zu, closed by server: %zu\n",
+           count, stats.connected, stats.loggedIn, stats.failed, stats.closed);
+    printf("last login after %.0f ms, %zu server events in %u s\n", lastLoginMs, stats.events, seconds);
+
+    sessions.clear();
+    WSACleanup();
+    return 0;
+}
@@ -0,0 +1,640 @@
+// chat_session.h - Event-driven client sessions for the chat server
+//
+// A SessionLoop owns a hidden window that receives WSAAsyncSelect socket
+// notifications, WSAAsyncGetHostByName replies and timers for every session
+// created on it, so one thread can drive any number of ChatSessions. A GUI needs nothing extra: its own
+// message loop dispatches to the hidden window. Console programs call Run().
+//
+// All callbacks run on the loop's thread. Don't destroy a session from its
+// own callback; call Close() instead.
+#pragma once
+
+#include <winsock2.h>
+#include <windows.h>
+#include <mstcpip.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <map>
+#include <functional>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+const uint16_t DEFAULT_PORT = 5000;
+
+// Dead-peer detection
+const DWORD AUTH_TIMEOUT_MS = 10000;       // max wait for the login/register reply
+const ULONG KEEPALIVE_IDLE_MS = 30000;     // quiet time before the first probe
+const ULONG KEEPALIVE_INTERVAL_MS = 5000;  // gap between unanswered probes
+
+#define WM_SOCKET_EVENT (WM_USER + 2)
+#define WM_RESOLVE_EVENT (WM_USER + 3)
+
+// Reason given to callbacks that were still waiting when Close() was called
+const char* const SESSION_CLOSED_LOCALLY = "Session closed";
+
+// Encryption/Decryption
+inline std::string aesDecrypt(const std::string& hex, const std::string& key) {
+    std::string decrypted;
+    if (key.empty()) return "[NO_KEY]";
+
+    for (size_t i = 0; i + 1 < hex.length(); i += 2) {
+        std::string byteStr = hex.substr(i, 2);
+        unsigned char byteVal = (unsigned char)strtol(byteStr.c_str(), nullptr, 16);
+        char decryptedChar = byteVal ^ key[(i / 2) % key.length()];
+        decrypted += decryptedChar;
+    }
+    return decrypted;
+}
+
+inline std::string aesEncrypt(const std::string& message, const std::string& key) {
+    if (key.empty()) return "[NO_KEY]";
+
+    std::string encrypted;
+    for (size_t i = 0; i < message.length(); i++) {
+        char encryptedChar = message[i] ^ key[i % key.length()];
+        char hex[3];
+        snprintf(hex, sizeof(hex), "%02x", (unsigned char)encryptedChar);
+        encrypted += hex;
+    }
+    return encrypted;
+}
+
+// Reads one '\n'-terminated line. Returns false when the socket has no more
+// data right now (non-blocking) or the connection is gone.
+inline bool RecvLine(SOCKET s, std::string& out, std::string& leftover) {
+    size_t pos;
+    while (true) {
+        pos = leftover.find('\n');
+        if (pos != std::string::npos) {
+            out = leftover.substr(0, pos);
+            leftover.erase(0, pos + 1);
+            if (!out.empty() && out.back() == '\r') out.pop_back();
+            return true;
+        }
+        char buffer[4096];
+        int bytes = recv(s, buffer, sizeof(buffer), 0);
+        if (bytes <= 0) return false;
+        leftover.append(buffer, bytes);
+        if (leftover.size() > 10000) {
+            leftover.clear();
+            return false;
+        }
+    }
+}
+
+class ChatSession;
+
+class SessionLoop {
+public:
+    SessionLoop() : window(NULL), running(false), nextTimerId(1) {}
+    ~SessionLoop() { if (window) DestroyWindow(window); }
+
+    SessionLoop(const SessionLoop&) = delete;
+    SessionLoop& operator=(const SessionLoop&) = delete;
+
+    // Pumps this thread's messages until Stop()
+    void Run() {
+        running = true;
+        MSG msg;
+        while (running && GetMessage(&msg, NULL, 0, 0) > 0) {
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+    }
+
+    void Stop() {
+        running = false;
+        PostMessage(Window(), WM_NULL, 0, 0);
+    }
+
+    // Repeats every `ms` until StopTimer. Ids are never reused, so a tick
+    // already queued for a stopped timer is dropped.
+    UINT_PTR StartTimer(UINT ms, std::function<void()> fire) {
+        UINT_PTR id = nextTimerId++;
+        timers[id] = fire;
+        SetTimer(Window(), id, ms, NULL);
+        return id;
+    }
+
+    void StopTimer(UINT_PTR id) {
+        if (timers.erase(id)) KillTimer(Window(), id);
+    }
+
+    // Switches the socket to non-blocking notifications on this loop
+    void Watch(SOCKET s, ChatSession* session) {
+        sessions[s] = session;
+        WSAAsyncSelect(s, Window(), WM_SOCKET_EVENT, FD_CONNECT | FD_READ | FD_WRITE | FD_CLOSE);
+    }
+
+    // Call before closesocket: also drops notifications already queued for
+    // this socket, so they can't reach a later socket that reuses the handle.
+    void Unwatch(SOCKET s) {
+        WSAAsyncSelect(s, Window(), 0, 0);
+        sessions.erase(s);
+        DropQueued(WM_SOCKET_EVENT, (WPARAM)s);
+    }
+
+    // Looks up `host` without blocking the thread; the hostent is written to
+    // `buffer` (MAXGETHOSTSTRUCT bytes, kept alive until the reply). Returns
+    // NULL if the lookup could not be started.
+    HANDLE Resolve(const std::string& host, char* buffer, int size, ChatSession* session) {
+        HANDLE request = WSAAsyncGetHostByName(Window(), WM_RESOLVE_EVENT, host.c_str(), buffer, size);
+        if (request) lookups[request] = session;
+        return request;
+    }
+
+    void CancelResolve(HANDLE request) {
+        WSACancelAsyncRequest(request);
+        lookups.erase(request);
+        DropQueued(WM_RESOLVE_EVENT, (WPARAM)request);
+    }
+
+private:
+    void DropQueued(UINT message, WPARAM key) {
+        std::deque<MSG> others;
+        MSG msg;
+        while (PeekMessage(&msg, Window(), message, message, PM_REMOVE)) {
+            if (msg.wParam != key) others.push_back(msg);
+        }
+        for (const MSG& other : others) {
+            PostMessage(Window(), message, other.wParam, other.lParam);
+        }
+    }
+
+    HWND Window() {
+        if (!window) {
+            WNDCLASSEXA wc{};
+            wc.cbSize = sizeof(WNDCLASSEXA);
+            wc.lpfnWndProc = WindowProc;
+            wc.hInstance = GetModuleHandle(NULL);
+            wc.lpszClassName = "ChatSessionLoop";
+            RegisterClassExA(&wc);  // fails harmlessly if another loop registered it
+
+            window = CreateWindowExA(0, "ChatSessionLoop", "", 0, 0, 0, 0, 0,
+                                     HWND_MESSAGE, NULL, wc.hInstance, NULL);
+            SetWindowLongPtrA(window, GWLP_USERDATA, (LONG_PTR)this);
+        }
+        return window;
+    }
+
+    static LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+
+    HWND window;
+    bool running;
+    UINT_PTR nextTimerId;
+    std::map<SOCKET, ChatSession*> sessions;
+    std::map<HANDLE, ChatSession*> lookups;
+    std::map<UINT_PTR, std::function<void()>> timers;
+};
+
+enum ChatEventType {
+    EVENT_KEY_ESTABLISHED,   // session key received, messages can be decrypted
+    EVENT_MESSAGE,           // decrypted message from `partner`
+    EVENT_PARTNER_CONNECTED, // chat opened with `partner`
+    EVENT_PARTNER_LEFT,      // chat closed, `text` is the server's notice
+    EVENT_INFO,              // any other server line, in `text`
+    EVENT_CLOSED             // connection to the server is gone
+};
+
+struct ChatEvent {
+    ChatEventType type;
+    std::string partner;
+    std::string text;
+};
+
+enum SessionState {
+    SESSION_CLOSED,
+    SESSION_RESOLVING,
+    SESSION_CONNECTING,
+    SESSION_CONNECTED,       // waiting for Login
+    SESSION_AUTHENTICATING,
+    SESSION_READY
+};
+
+class ChatSession {
+public:
+    typedef std::function<void(bool ok, const std::string& error)> Completion;
+    typedef std::function<void(const ChatEvent& event)> EventHandler;
+
+    explicit ChatSession(SessionLoop& loop)
+        : loop(loop), socket(INVALID_SOCKET), resolveRequest(NULL), serverPort(0), state(SESSION_CLOSED),
+          loginTimer(0), delivering(false) {}
+    ~ChatSession() { Close(); }
+
+    ChatSession(const ChatSession&) = delete;
+    ChatSession& operator=(const ChatSession&) = delete;
+
+    // Connects to "host" or "host:port". Neither the name lookup nor the TCP
+    // connect blocks; `done` runs once the connection is up or has failed.
+    void Connect(const std::string& address, Completion done) {
+        Close();
+
+        std::string host;
+        int port = DEFAULT_PORT;
+        size_t colonPos = address.find(':');
+        if (colonPos != std::string::npos) {
+            host = address.substr(0, colonPos);
+            try { port = std::stoi(address.substr(colonPos + 1)); } catch (...) { done(false, "Invalid port"); return; }
+        } else host = address;
+
+        pending = done;
+        serverPort = htons(port);
+        unsigned long ip = inet_addr(host.c_str());
+        if (ip != INADDR_NONE) {
+            StartConnect(ip);
+            return;
+        }
+
+        hostBuffer.assign(MAXGETHOSTSTRUCT, 0);
+        resolveRequest = loop.Resolve(host, hostBuffer.data(), (int)hostBuffer.size(), this);
+        if (!resolveRequest) {
+            Fail("Unknown host");
+            return;
+        }
+        state = SESSION_RESOLVING;
+    }
+
+    // mode is "login" or "register". If the server rejects the credentials the
+    // session stays connected so the user can try again; if it goes away or
+    // does not answer within AUTH_TIMEOUT_MS the session is closed and
+    // EVENT_CLOSED is queued as well.
+    void Login(const std::string& mode, const std::string& username, const std::string& password,
+               Completion done) {
+        if (state == SESSION_AUTHENTICATING) { done(false, "Already logging in"); return; }
+        if (state != SESSION_CONNECTED) { done(false, "Not connected to the server"); return; }
+        if (!Write(mode) || !Write(username) || !Write(password)) {
+            done(false, "Failed to send credentials");
+            return;
+        }
+        state = SESSION_AUTHENTICATING;
+        pendingUsername = username;
+        pending = done;
+        loginTimer = loop.StartTimer(AUTH_TIMEOUT_MS, [this]() { OnLoginTimeout(); });
+    }
+
+    // `handler` runs once, for the next event; call again from it to keep
+    // listening. Events that arrive with no handler waiting are queued. A
+    // closed session with nothing queued answers with EVENT_CLOSED at once.
+    void NextEvent(EventHandler handler) {
+        eventHandler = handler;
+        if (eventHandler && state == SESSION_CLOSED && events.empty()) {
+            events.push_back({ EVENT_CLOSED, "", SESSION_CLOSED_LOCALLY });
+        }
+        Deliver();
+    }
+
+    bool Send(const std::string& conversation, const std::string& text) {
+        return state == SESSION_READY && Write("[CHAT][" + conversation + "] " + text);
+    }
+
+    bool OpenConversation(const std::string& user) {
+        return state == SESSION_READY && Write("connect " + user);
+    }
+
+    bool CloseConversation() {
+        if (state != SESSION_READY || !Write("disconnect")) return false;
+        partner.clear();
+        return true;
+    }
+
+    bool ListUsers() {
+        return state == SESSION_READY && Write("list");
+    }
+
+    // Says goodbye when logged in, then drops the connection and discards
+    // queued events. Nothing is left hanging: a pending Connect/Login fails
+    // and a waiting NextEvent handler gets EVENT_CLOSED, both with
+    // SESSION_CLOSED_LOCALLY. The destructor closes too, so those callbacks
+    // may run while the session is being destroyed.
+    void Close() {
+        if (state == SESSION_READY) Write("exit");
+        Completion done;
+        done.swap(pending);
+        EventHandler handler;
+        handler.swap(eventHandler);
+        Drop();
+        events.clear();
+        if (handler) handler({ EVENT_CLOSED, "", SESSION_CLOSED_LOCALLY });
+        if (done) done(false, SESSION_CLOSED_LOCALLY);
+    }
+
+    SessionState State() const { return state; }
+    const std::string& Username() const { return username; }
+    const std::string& Partner() const { return partner; }
+
+private:
+    friend class SessionLoop;
+
+    void OnResolved(WORD error) {
+        resolveRequest = NULL;
+        if (error) {
+            Fail("Unknown host");
+            return;
+        }
+        hostent* he = (hostent*)hostBuffer.data();
+        unsigned long ip;
+        memcpy(&ip, he->h_addr, sizeof(ip));
+        StartConnect(ip);
+    }
+
+    void StartConnect(unsigned long ip) {
+        sockaddr_in serverAddr{};
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = serverPort;
+        serverAddr.sin_addr.s_addr = ip;
+
+        socket = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (socket == INVALID_SOCKET) {
+            Fail("Could not create socket");
+            return;
+        }
+        EnableKeepAlive();
+        loop.Watch(socket, this);
+
+        if (connect(socket, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR &&
+            WSAGetLastError() != WSAEWOULDBLOCK) {
+            Fail("Could not reach the server");
+            return;
+        }
+        state = SESSION_CONNECTING;
+    }
+
+    // Drops the connection and fails the pending Connect
+    void Fail(const std::string& reason) {
+        Completion done;
+        done.swap(pending);
+        Drop();
+        if (done) done(false, reason);
+    }
+
+    // Releases the connection but keeps queued events for the handler.
+    // Callers take `pending` first so they can report the failure.
+    void Drop() {
+        if (resolveRequest) {
+            loop.CancelResolve(resolveRequest);
+            resolveRequest = NULL;
+        }
+        if (socket != INVALID_SOCKET) {
+            loop.Unwatch(socket);
+            closesocket(socket);
+            socket = INVALID_SOCKET;
+        }
+        if (loginTimer) {
+            loop.StopTimer(loginTimer);
+            loginTimer = 0;
+        }
+        state = SESSION_CLOSED;
+        leftover.clear();
+        outbox.clear();
+        sessionKey.clear();
+        partner.clear();
+    }
+
+    // The protocol has no ping, so let the TCP stack probe an idle connection.
+    // If the server stops answering, the connection is reset and FD_CLOSE is
+    // posted instead of the session hanging half-open.
+    void EnableKeepAlive() {
+        tcp_keepalive settings{};
+        settings.onoff = 1;
+        settings.keepalivetime = KEEPALIVE_IDLE_MS;
+        settings.keepaliveinterval = KEEPALIVE_INTERVAL_MS;
+        DWORD bytesReturned = 0;
+        if (WSAIoctl(socket, SIO_KEEPALIVE_VALS, &settings, sizeof(settings),
+                     NULL, 0, &bytesReturned, NULL, NULL) == SOCKET_ERROR) {
+            BOOL on = TRUE;
+            setsockopt(socket, SOL_SOCKET, SO_KEEPALIVE, (const char*)&on, sizeof(on));
+        }
+    }
+
+    void OnSocketEvent(WORD event, WORD error) {
+        switch (event) {
+            case FD_CONNECT:
+                if (error) {
+                    Fail("Could not reach the server");
+                } else {
+                    state = SESSION_CONNECTED;
+                    Complete(true, "");
+                }
+                break;
+
+            case FD_READ: {
+                std::string line;
+                while (socket != INVALID_SOCKET && RecvLine(socket, line, leftover)) HandleLine(line);
+                break;
+            }
+
+            case FD_WRITE:
+                Flush();
+                break;
+
+            case FD_CLOSE:
+                OnClosed();
+                break;
+        }
+    }
+
+    void OnClosed() {
+        // Deliver whatever the server sent before closing
+        std::string line;
+        while (socket != INVALID_SOCKET && RecvLine(socket, line, leftover)) HandleLine(line);
+        if (state == SESSION_CLOSED) return;
+
+        Shutdown("Connection to the server was lost");
+    }
+
+    // Drops the connection, then reports it to the pending Connect/Login (if
+    // any) and as EVENT_CLOSED
+    void Shutdown(const std::string& reason) {
+        Completion done;
+        done.swap(pending);
+        Drop();
+        Push({ EVENT_CLOSED, "", reason });
+        if (done) done(false, reason);
+    }
+
+    void OnLoginTimeout() {
+        loop.StopTimer(loginTimer);
+        loginTimer = 0;
+        if (state != SESSION_AUTHENTICATING) return;
+        // A reply may still be on its way; reading it later would put the
+        // next login attempt out of step, so give up on this connection.
+        Shutdown("The server did not respond");
+    }
+
+    void HandleLine(const std::string& message) {
+        if (message.empty()) return;
+
+        if (state == SESSION_AUTHENTICATING) {
+            loop.StopTimer(loginTimer);
+            loginTimer = 0;
+            if (message.find("ERROR:") == 0) {
+                state = SESSION_CONNECTED;
+                Complete(false, message.substr(6));
+            } else if (message.find("REGISTER_SUCCESS:") == 0 ||
+                       message.find("LOGIN_SUCCESS:") == 0) {
+                username = pendingUsername;
+                state = SESSION_READY;
+                Complete(true, "");
+            } else {
+                state = SESSION_CONNECTED;
+                Complete(false, "Unexpected reply from the server");
+            }
+            return;
+        }
+
+        // Handle session key
+        if (message.rfind("SESSION_KEY:", 0) == 0) {
+            sessionKey = message.substr(12);
+            Push({ EVENT_KEY_ESTABLISHED, "", "" });
+            return;
+        }
+
+        // Handle encrypted messages - DECRYPT LOCALLY
+        if (message.rfind("ENCRYPTED:", 0) == 0) {
+            std::string encryptedHex = message.substr(10);
+            if (!sessionKey.empty()) {
+                Push({ EVENT_MESSAGE, partner, aesDecrypt(encryptedHex, sessionKey) });
+            } else {
+                Push({ EVENT_INFO, "", "[Unable to decrypt - no key]" });
+            }
+            return;
+        }
+
+        // Handle connection messages (support both plain and emoji-prefixed)
+        if (message.find("CONNECTED:") != std::string::npos ||
+            message.find("🎉 CONNECTED:") != std::string::npos) {
+
+            size_t pos = message.find("with ");
+            if (pos != std::string::npos) {
+                partner = message.substr(pos + 5);
+                // Trim spaces/newlines
+                partner.erase(std::remove_if(partner.begin(), partner.end(), ::isspace), partner.end());
+                Push({ EVENT_PARTNER_CONNECTED, partner, "" });
+            } else {
+                Push({ EVENT_INFO, "", message });
+            }
+            return;
+        }
+
+        // Handle [CHAT] messages
+        if (message.find("[CHAT]") != std::string::npos) {
+            // Extract sender name between second pair of brackets: [CHAT][username]
+            size_t start = message.find('[', message.find("[CHAT]") + 6);
+            size_t end = message.find(']', start + 1);
+            std::string sender;
+            if (start != std::string::npos && end != std::string::npos)
+                sender = message.substr(start + 1, end - start - 1);
+
+            // Skip your own message echoed back
+            if (_stricmp(sender.c_str(), username.c_str()) != 0) {
+                Push({ EVENT_INFO, "", message });
+            }
+            return;
+        }
+
+        // Handle disconnection
+        if (message.find("DISCONNECTED:") == 0) {
+            partner.clear();
+            Push({ EVENT_PARTNER_LEFT, "", message.substr(13) });
+            return;
+        }
+
+        // Default: informational
+        Push({ EVENT_INFO, "", message });
+    }
+
+    // Queues a line and sends as much as the socket takes; the rest goes out
+    // on FD_WRITE.
+    bool Write(const std::string& line) {
+        if (socket == INVALID_SOCKET) return false;
+        outbox += line + "\n";
+        return Flush();
+    }
+
+    bool Flush() {
+        while (!outbox.empty()) {
+            int sent = send(socket, outbox.c_str(), (int)outbox.size(), 0);
+            if (sent == SOCKET_ERROR) return WSAGetLastError() == WSAEWOULDBLOCK;
+            outbox.erase(0, sent);
+        }
+        return true;
+    }
+
+    // Runs and clears the pending Connect/Login completion. The callback may
+    // start a new operation on this session, so nothing touches state after.
+    void Complete(bool ok, const std::string& error) {
+        Completion done;
+        done.swap(pending);
+        if (done) done(ok, error);
+    }
+
+    void Push(const ChatEvent& event) {
+        events.push_back(event);
+        Deliver();
+    }
+
+    // A handler that calls NextEvent again is served by this loop rather
+    // than recursively.
+    void Deliver() {
+        if (delivering) return;
+        delivering = true;
+        while (eventHandler && !events.empty()) {
+            EventHandler handler;
+            handler.swap(eventHandler);
+            ChatEvent event = events.front();
+            events.pop_front();
+            handler(event);
+        }
+        delivering = false;
+    }
+
+    SessionLoop& loop;
+    SOCKET socket;
+    HANDLE resolveRequest;
+    std::vector<char> hostBuffer;  // hostent written by WSAAsyncGetHostByName
+    u_short serverPort;            // network byte order
+    SessionState state;
+    UINT_PTR loginTimer;
+    Completion pending;  // Connect or Login in progress
+    std::string pendingUsername;
+    std::string username;
+    std::string leftover;
+    std::string outbox;
+    std::string sessionKey;
+    std::string partner;
+    std::deque<ChatEvent> events;
+    EventHandler eventHandler;
+    bool delivering;
+};
+
+inline LRESULT CALLBACK SessionLoop::WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+    SessionLoop* loop = (SessionLoop*)GetWindowLongPtrA(hwnd, GWLP_USERDATA);
+    if (loop && uMsg == WM_SOCKET_EVENT) {
+        auto found = loop->sessions.find((SOCKET)wParam);
+        if (found != loop->sessions.end())
+            found->second->OnSocketEvent(WSAGETSELECTEVENT(lParam), WSAGETSELECTERROR(lParam));
+        return 0;
+    }
+    if (loop && uMsg == WM_RESOLVE_EVENT) {
+        auto found = loop->lookups.find((HANDLE)wParam);
+        if (found != loop->lookups.end()) {
+            ChatSession* session = found->second;
+            loop->lookups.erase(found);
+            session->OnResolved(WSAGETASYNCERROR(lParam));
+        }
+        return 0;
+    }
+    if (loop && uMsg == WM_TIMER) {
+        auto found = loop->timers.find(wParam);
+        if (found != loop->timers.end()) {
+            std::function<void()> fire = found->second;  // may stop itself
+            fire();
+        }
+        return 0;
+    }
+    return DefWindowProcA(hwnd, uMsg, wParam, lParam);
+}
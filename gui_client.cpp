@@ -10,15 +10,15 @@
 #include <commctrl.h>
 #include <uxtheme.h>
 #include <string>
-#include <thread>
-#include <atomic>
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <vector>
 
-using namespace std;
+#include "chat_session.h"
+#include "history_index.h"
 
-const uint16_t DEFAULT_PORT = 5000;
+using namespace std;
 
 // Modern color scheme
 #define APP_COLOR_BACKGROUND RGB(18, 18, 18)
@@ -46,6 +46,8 @@ const uint16_t DEFAULT_PORT = 5000;
 #define IDC_DISCONNECT_BTN  1011
 #define IDC_LIST_USERS_BTN  1012
 #define IDC_STATUS_BAR      1013
+#define IDC_SEARCH_INPUT    1014
+#define IDC_SEARCH_BTN      1015
 
 // Window states
 enum AppState {
@@ -59,15 +61,16 @@ HWND g_hWnd = NULL;
 HWND g_hChatDisplay = NULL;
 HWND g_hMessageInput = NULL;
 HWND g_hStatusBar = NULL;
-SOCKET g_socket = INVALID_SOCKET;
-atomic<bool> g_running(true);
-atomic<bool> g_authenticated(false);
 AppState g_currentState = STATE_SERVER_CONNECT;
-string g_username;
-string g_leftover;
-string g_sessionKey;
-string g_currentPartner;
-thread* g_receiverThread = nullptr;
+
+// Server connection, driven by this thread's message loop
+SessionLoop g_loop;
+ChatSession g_session(g_loop);
+
+// Local history search
+const size_t MAX_SEARCH_RESULTS = 50;
+
+HistoryIndex g_history;
 
 // Fonts
 HFONT g_hFontTitle = NULL;
@@ -86,70 +89,13 @@ void CreateAuthUI(HWND hwnd);
 void CreateChatUI(HWND hwnd);
 void AppendToChatDisplay(const string& text, bool isSystem = false, bool isOwn = false);
 void SetStatus(const string& text);
-bool SendLine(SOCKET s, const string& text);
-bool RecvLine(SOCKET s, string& out, string& leftover);
-void ReceiverThreadFunc();
-bool ConnectToServer(const string& address);
-bool Authenticate(const string& mode, const string& username, const string& password);
+void WaitForChatEvent();
+void OnChatEvent(const ChatEvent& event);
 void SendMessage();
+void RunSearch();
 
 #define WM_CLEAR_CHAT (WM_USER + 1)
 
-// Encryption/Decryption
-string aesDecrypt(const string& hex, const string& key) {
-    string decrypted;
-    if (key.empty()) return "[NO_KEY]";
-
-    for (size_t i = 0; i + 1 < hex.length(); i += 2) {
-        string byteStr = hex.substr(i, 2);
-        unsigned char byteVal = (unsigned char)strtol(byteStr.c_str(), nullptr, 16);
-        char decryptedChar = byteVal ^ key[(i / 2) % key.length()];
-        decrypted += decryptedChar;
-    }
-    return decrypted;
-}
-
-string aesEncrypt(const string& message, const string& key) {
-    if (key.empty()) return "[NO_KEY]";
-    
-    string encrypted;
-    for (size_t i = 0; i < message.length(); i++) {
-        char encryptedChar = message[i] ^ key[i % key.length()];
-        char hex[3];
-        snprintf(hex, sizeof(hex), "%02x", (unsigned char)encryptedChar);
-        encrypted += hex;
-    }
-    return encrypted;
-}
-
-// Utilities
-bool SendLine(SOCKET s, const string& text) {
-    string message = text + "\n";
-    int result = send(s, message.c_str(), (int)message.size(), 0);
-    return result != SOCKET_ERROR;
-}
-
-bool RecvLine(SOCKET s, string& out, string& leftover) {
-    size_t pos;
-    while (true) {
-        pos = leftover.find('\n');
-        if (pos != string::npos) {
-            out = leftover.substr(0, pos);
-            leftover.erase(0, pos + 1);
-            if (!out.empty() && out.back() == '\r') out.pop_back();
-            return true;
-        }
-        char buffer[4096];
-        int bytes = recv(s, buffer, sizeof(buffer), 0);
-        if (bytes <= 0) return false;
-        leftover.append(buffer, bytes);
-        if (leftover.size() > 10000) {
-            leftover.clear();
-            return false;
-        }
-    }
-}
-
 void AppendToChatDisplay(const string& text, bool isSystem, bool isOwn) {
     if (!g_hChatDisplay) return;
     
@@ -158,8 +104,8 @@ void AppendToChatDisplay(const string& text, bool isSystem, bool isOwn) {
         prefix = "[SYSTEM] ";
     } else if (isOwn) {
         prefix = "[You] ";
-    } else if (!g_currentPartner.empty()) {
-        prefix = "[" + g_currentPartner + "] ";
+    } else if (!g_session.Partner().empty()) {
+        prefix = "[" + g_session.Partner() + "] ";
     }
     
     int len = GetWindowTextLengthA(g_hChatDisplay);
@@ -173,81 +119,46 @@ void SetStatus(const string& text) {
         SendMessageA(g_hStatusBar, SB_SETTEXTA, 0, (LPARAM)text.c_str());
 }
 
-// Receiver Thread
-void ReceiverThreadFunc() {
-    u_long mode = 1;
-    ioctlsocket(g_socket, FIONBIO, &mode);
-
-    string message;
-    while (g_running && g_authenticated) {
-        if (RecvLine(g_socket, message, g_leftover)) {
-            if (message.empty()) continue;
-
-            // Handle session key
-            if (message.rfind("SESSION_KEY:", 0) == 0) {
-                g_sessionKey = message.substr(12);
-                AppendToChatDisplay("Secure encryption key established", true);
-                continue;
-            }
+// Server events
+// Armed as soon as the connection is up and re-armed after every event, so a
+// lost server is noticed on the login screen as well as in chat.
+void WaitForChatEvent() {
+    g_session.NextEvent(OnChatEvent);
+}
 
-            // Handle encrypted messages - DECRYPT LOCALLY
-            if (message.rfind("ENCRYPTED:", 0) == 0) {
-                string encryptedHex = message.substr(10);
-                if (!g_sessionKey.empty()) {
-                    string decrypted = aesDecrypt(encryptedHex, g_sessionKey);
-                    AppendToChatDisplay(decrypted, false, false);
-                } else {
-                    AppendToChatDisplay("[Unable to decrypt - no key]", true);
-                }
-                continue;
-            }
+void OnChatEvent(const ChatEvent& event) {
+    switch (event.type) {
+        case EVENT_KEY_ESTABLISHED:
+            AppendToChatDisplay("Secure encryption key established", true);
+            break;
 
-            // Handle connection messages (support both plain and emoji-prefixed)
-            if (message.find("CONNECTED:") != string::npos ||
-                message.find("🎉 CONNECTED:") != string::npos) {
-
-                size_t pos = message.find("with ");
-                if (pos != string::npos) {
-                    g_currentPartner = message.substr(pos + 5);
-                    // Trim spaces/newlines
-                    g_currentPartner.erase(remove_if(g_currentPartner.begin(),
-                        g_currentPartner.end(), ::isspace), g_currentPartner.end());
-                    AppendToChatDisplay("Connected with " + g_currentPartner, true);
-                } else {
-                    AppendToChatDisplay(message, true);
-                }
-                continue;
-            }
+        case EVENT_MESSAGE:
+            // Not indexed when no partner is known (HistoryIndex skips it)
+            g_history.Add(event.partner, event.partner, event.text);
+            AppendToChatDisplay(event.text, false, false);
+            break;
 
-            // Handle [CHAT] messages
-            if (message.find("[CHAT]") != string::npos) {
-                // Extract sender name between second pair of brackets: [CHAT][username]
-                size_t start = message.find('[', message.find("[CHAT]") + 6);
-                size_t end = message.find(']', start + 1);
-                string sender;
-                if (start != string::npos && end != string::npos)
-                    sender = message.substr(start + 1, end - start - 1);
-
-                // Skip displaying your own message again
-                if (_stricmp(sender.c_str(), g_username.c_str()) != 0) {
-                    AppendToChatDisplay(message, true);
-                }
-                continue;
-            }
+        case EVENT_PARTNER_CONNECTED:
+            AppendToChatDisplay("Connected with " + event.partner, true);
+            break;
 
-            // Handle disconnection
-            if (message.find("DISCONNECTED:") == 0) {
-                AppendToChatDisplay(message.substr(13), true);
-                g_currentPartner.clear();
-                continue;
-            }
+        case EVENT_PARTNER_LEFT:
+        case EVENT_INFO:
+            AppendToChatDisplay(event.text, true);
+            break;
 
-            // Default: display as system or informational
-            AppendToChatDisplay(message, true);
-        } else {
-            Sleep(50);
-        }
+        case EVENT_CLOSED:
+            // Closed by us (window closing or a new connect): nothing to report
+            if (event.text == SESSION_CLOSED_LOCALLY) return;
+            g_history = HistoryIndex();
+            g_currentState = STATE_SERVER_CONNECT;
+            CreateServerConnectUI(g_hWnd);
+            SetStatus("Disconnected from server");
+            MessageBoxA(g_hWnd, (event.text + ".\nConnect again to continue.").c_str(),
+                        "Disconnected", MB_OK | MB_ICONWARNING);
+            return;
     }
+    WaitForChatEvent();
 }
 
 // Modern UI Button
@@ -279,6 +190,8 @@ void CreateServerConnectUI(HWND hwnd) {
         if (child != g_hStatusBar) DestroyWindow(child);
         child = next;
     }
+    g_hChatDisplay = NULL;
+    g_hMessageInput = NULL;
 
     // Title
     HWND hTitle = CreateWindowA("STATIC", "Connect to Chat Server",
@@ -374,6 +287,10 @@ void CreateChatUI(HWND hwnd) {
     CreateModernButton(hwnd, "Disconnect", 360, 411, 95, 27, IDC_DISCONNECT_BTN);
     CreateModernButton(hwnd, "List Users", 465, 411, 95, 27, IDC_LIST_USERS_BTN);
 
+    // History search
+    CreateModernInput(hwnd, "search", 575, 412, 120, 25, IDC_SEARCH_INPUT);
+    CreateModernButton(hwnd, "Search", 700, 411, 80, 27, IDC_SEARCH_BTN);
+
     // Message input
     CreateWindowA("STATIC", "Message:",
         WS_CHILD | WS_VISIBLE,
@@ -383,15 +300,16 @@ void CreateChatUI(HWND hwnd) {
     CreateModernButton(hwnd, "Send", 680, 452, 100, 30, IDC_SEND_BTN, true);
 
     AppendToChatDisplay("=== Secure Chat Connected ===", true);
-    AppendToChatDisplay("Logged in as: " + g_username, true);
+    AppendToChatDisplay("Logged in as: " + g_session.Username(), true);
     AppendToChatDisplay("", true);
     AppendToChatDisplay("Commands:", true);
     AppendToChatDisplay("  • Enter username and click Connect to start chatting", true);
     AppendToChatDisplay("  • Click List Users to see who's online", true);
+    AppendToChatDisplay("  • Use Search to find words in this session's messages", true);
     AppendToChatDisplay("  • All messages are encrypted end-to-end", true);
     AppendToChatDisplay("", true);
 
-    SetStatus("Logged in as " + g_username + " - Ready to chat");
+    SetStatus("Logged in as " + g_session.Username() + " - Ready to chat");
     SetFocus(g_hMessageInput);
 }
 
@@ -503,20 +421,22 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                         char address[256];
                         GetWindowTextA(GetDlgItem(hwnd, IDC_SERVER_INPUT), address, sizeof(address));
                         SetStatus("Connecting to server...");
-                        if (ConnectToServer(address)) {
-                            g_currentState = STATE_AUTH;
-                            CreateAuthUI(hwnd);
-                        } else {
-                            MessageBoxA(hwnd, "Failed to connect to server.\nEnsure the server is running.",
-                                        "Connection Error", MB_OK | MB_ICONERROR);
-                            SetStatus("Connection failed");
-                        }
+                        g_session.Connect(address, [hwnd](bool ok, const string& error) {
+                            if (ok) {
+                                g_currentState = STATE_AUTH;
+                                CreateAuthUI(hwnd);
+                                WaitForChatEvent();
+                            } else if (error != SESSION_CLOSED_LOCALLY) {
+                                MessageBoxA(hwnd, "Failed to connect to server.\nEnsure the server is running.",
+                                            "Connection Error", MB_OK | MB_ICONERROR);
+                                SetStatus("Connection failed");
+                            }
+                        });
                     } else if (g_currentState == STATE_CHAT) {
                         char targetUser[256];
                         GetWindowTextA(GetDlgItem(hwnd, IDC_CONNECT_USER), targetUser, sizeof(targetUser));
                         if (strlen(targetUser) > 0) {
-                            string cmd = string("connect ") + targetUser;
-                            SendLine(g_socket, cmd);
+                            g_session.OpenConversation(targetUser);
                             SetWindowTextA(GetDlgItem(hwnd, IDC_CONNECT_USER), "");
                         }
                     }
@@ -533,13 +453,18 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                     }
                     string mode = (LOWORD(wParam) == IDC_REGISTER_BTN) ? "register" : "login";
                     SetStatus("Authenticating...");
-                    if (Authenticate(mode, username, password)) {
-                        g_currentState = STATE_CHAT;
-                        CreateChatUI(hwnd);
-                        g_receiverThread = new thread(ReceiverThreadFunc);
-                    } else {
-                        SetStatus("Authentication failed");
-                    }
+                    g_session.Login(mode, username, password, [hwnd](bool ok, const string& error) {
+                        if (ok) {
+                            // Search only covers this login; another account may use the app next
+                            g_history = HistoryIndex();
+                            g_currentState = STATE_CHAT;
+                            CreateChatUI(hwnd);
+                        } else if (g_session.State() != SESSION_CLOSED) {
+                            // Lost connections and timeouts arrive as EVENT_CLOSED
+                            MessageBoxA(hwnd, error.c_str(), "Authentication Error", MB_OK | MB_ICONERROR);
+                            SetStatus("Authentication failed");
+                        }
+                    });
                     break;
                 }
 
@@ -548,13 +473,16 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                     break;
 
                 case IDC_DISCONNECT_BTN:
-                    SendLine(g_socket, "disconnect");
-                    g_currentPartner.clear();
+                    g_session.CloseConversation();
                     AppendToChatDisplay("Disconnected from chat", true);
                     break;
 
                 case IDC_LIST_USERS_BTN:
-                    SendLine(g_socket, "list");
+                    g_session.ListUsers();
+                    break;
+
+                case IDC_SEARCH_BTN:
+                    RunSearch();
                     break;
 
                 case IDC_MESSAGE_INPUT:
@@ -566,16 +494,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             return 0;
 
         case WM_DESTROY:
-            g_running = false;
-            if (g_receiverThread) {
-                if (g_receiverThread->joinable()) g_receiverThread->join();
-                delete g_receiverThread;
-                g_receiverThread = nullptr;
-            }
-            if (g_socket != INVALID_SOCKET) {
-                SendLine(g_socket, "exit");
-                closesocket(g_socket);
-            }
+            g_session.Close();
             
             if (g_hFontTitle) DeleteObject(g_hFontTitle);
             if (g_hFontNormal) DeleteObject(g_hFontNormal);
@@ -591,58 +510,6 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     return DefWindowProc(hwnd, uMsg, wParam, lParam);
 }
 
-bool ConnectToServer(const string& address) {
-    string host;
-    int port = DEFAULT_PORT;
-    size_t colonPos = address.find(':');
-    if (colonPos != string::npos) {
-        host = address.substr(0, colonPos);
-        try { port = stoi(address.substr(colonPos + 1)); } catch (...) { return false; }
-    } else host = address;
-
-    g_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (g_socket == INVALID_SOCKET) return false;
-
-    sockaddr_in serverAddr{};
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(port);
-    serverAddr.sin_addr.s_addr = inet_addr(host.c_str());
-    if (serverAddr.sin_addr.s_addr == INADDR_NONE) {
-        hostent* he = gethostbyname(host.c_str());
-        if (!he) { closesocket(g_socket); return false; }
-        memcpy(&serverAddr.sin_addr, he->h_addr, he->h_length);
-    }
-    if (connect(g_socket, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
-        closesocket(g_socket);
-        return false;
-    }
-    return true;
-}
-
-bool Authenticate(const string& mode, const string& username, const string& password) {
-    if (!SendLine(g_socket, mode) ||
-        !SendLine(g_socket, username) ||
-        !SendLine(g_socket, password))
-        return false;
-
-    string response;
-    if (!RecvLine(g_socket, response, g_leftover)) return false;
-
-    if (response.find("ERROR:") == 0) {
-        MessageBoxA(g_hWnd, response.substr(6).c_str(), "Authentication Error",
-                    MB_OK | MB_ICONERROR);
-        return false;
-    }
-
-    if (response.find("REGISTER_SUCCESS:") == 0 ||
-        response.find("LOGIN_SUCCESS:") == 0) {
-        g_username = username;
-        g_authenticated = true;
-        return true;
-    }
-    return false;
-}
-
 void SendMessage() {
     char buffer[1024];
     GetWindowTextA(g_hMessageInput, buffer, sizeof(buffer));
@@ -652,7 +519,8 @@ void SendMessage() {
     if (message.empty()) return;
 
     // Make sure we have a valid chat partner
-    if (g_currentPartner.empty()) {
+    string partner = g_session.Partner();
+    if (partner.empty()) {
         MessageBoxA(
             g_hWnd,
             "Please connect to a user first!",
@@ -662,12 +530,10 @@ void SendMessage() {
         return;
     }
 
-    // Format the message before sending (optional)
-    string formattedMessage = "[CHAT][" + g_currentPartner + "] " + message;
-
     // Send to server
-    if (SendLine(g_socket, formattedMessage)) {
+    if (g_session.Send(partner, message)) {
         // Show own message locally (decrypted preview)
+        g_history.Add(partner, g_session.Username(), message);
         AppendToChatDisplay(message, false, true);
 
         // Clear input box and focus back
@@ -683,6 +549,31 @@ void SendMessage() {
     }
 }
 
+void RunSearch() {
+    char buffer[256];
+    HWND hSearchInput = GetDlgItem(g_hWnd, IDC_SEARCH_INPUT);
+    GetWindowTextA(hSearchInput, buffer, sizeof(buffer));
+    string query = buffer;
+    if (query.empty()) return;
+
+    // Limit to the open conversation, or search everything when not connected
+    const string& partner = g_session.Partner();
+    vector<HistoryEntry> results = g_history.Search(query, partner, MAX_SEARCH_RESULTS);
+
+    AppendToChatDisplay("Search results for \"" + query + "\"" +
+        (partner.empty() ? "" : " with " + partner) + ":", true);
+    for (const HistoryEntry& entry : results) {
+        AppendToChatDisplay("  " + g_history.Name(entry.conversation) + " | " +
+            g_history.Name(entry.sender) + ": " + entry.text, true);
+    }
+    if (results.empty()) {
+        AppendToChatDisplay("  No matches", true);
+    } else if (results.size() == MAX_SEARCH_RESULTS) {
+        AppendToChatDisplay("  (showing the " + to_string(MAX_SEARCH_RESULTS) + " most recent)", true);
+    }
+    SetWindowTextA(hSearchInput, "");
+}
+
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow) {
     WSADATA wsaData;
     if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
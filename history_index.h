@@ -0,0 +1,192 @@
+// history_index.h - In-memory full-text index over local chat history
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <queue>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+
+struct HistoryEntry {
+    uint32_t conversation;  // name ids, see HistoryIndex::Name
+    uint32_t sender;
+    std::string text;
+};
+
+// Inverted index from words to message ids. Ids are assigned in arrival
+// order, so every posting list is sorted and the newest match is at its
+// back. Postings are kept both for all messages and per (conversation, word),
+// so a filtered search never looks at other conversations.
+class HistoryIndex {
+public:
+    // Words are lowercased runs of letters/digits; non-ASCII bytes are kept
+    // so UTF-8 words stay intact.
+    static std::vector<std::string> Tokenize(const std::string& text) {
+        std::vector<std::string> tokens;
+        std::string current;
+        for (unsigned char c : text) {
+            if (isalnum(c) || c >= 0x80) {
+                current += (char)tolower(c);
+            } else if (!current.empty()) {
+                tokens.push_back(current);
+                current.clear();
+            }
+        }
+        if (!current.empty()) tokens.push_back(current);
+        return tokens;
+    }
+
+    // Messages without a conversation or sender are not indexed
+    bool Add(const std::string& conversation, const std::string& sender, const std::string& text) {
+        if (conversation.empty() || sender.empty()) return false;
+
+        uint32_t id = (uint32_t)entries.size();
+        uint32_t conversationId = Intern(conversation);
+        entries.push_back({ conversationId, Intern(sender), text });
+
+        for (const std::string& token : Tokenize(text)) {
+            uint32_t tokenId = InternToken(token);
+            AddPosting(postings[tokenId], id);
+            AddPosting(conversationPostings[Key(conversationId, tokenId)], id);
+        }
+        return true;
+    }
+
+    // Every term is matched as a prefix; all terms must appear in the message.
+    // An empty conversation searches across all conversations. Newest first,
+    // at most `limit` results.
+    std::vector<HistoryEntry> Search(const std::string& query, const std::string& conversation,
+                                     size_t limit) const {
+        std::vector<HistoryEntry> results;
+        std::vector<std::string> terms = Tokenize(query);
+        if (terms.empty() || limit == 0) return results;
+
+        bool filtered = !conversation.empty();
+        uint32_t conversationId = 0;
+        if (filtered) {
+            auto name = nameIds.find(Lower(conversation));
+            if (name == nameIds.end()) return results;
+            conversationId = name->second;
+        }
+
+        std::vector<PrefixCursor> cursors(terms.size());
+        for (size_t t = 0; t < terms.size(); t++) {
+            const std::string& term = terms[t];
+            for (auto it = sortedTokens.lower_bound(term);
+                 it != sortedTokens.end() && it->first.compare(0, term.size(), term) == 0; ++it) {
+                if (!filtered) {
+                    cursors[t].AddList(postings[it->second]);
+                    continue;
+                }
+                auto list = conversationPostings.find(Key(conversationId, it->second));
+                if (list != conversationPostings.end()) cursors[t].AddList(list->second);
+            }
+        }
+
+        // Leapfrog intersection: walk down from the newest id until every term
+        // agrees on the same message, then continue below it.
+        uint32_t bound = UINT32_MAX;
+        while (results.size() < limit) {
+            uint32_t candidate;
+            if (!cursors[0].Seek(bound, candidate)) break;
+
+            size_t agreed = 1;
+            for (size_t i = 1 % cursors.size(); agreed < cursors.size(); i = (i + 1) % cursors.size()) {
+                uint32_t id;
+                if (!cursors[i].Seek(candidate, id)) return results;
+                if (id == candidate) {
+                    agreed++;
+                } else {
+                    candidate = id;
+                    agreed = 1;
+                }
+            }
+
+            results.push_back(entries[candidate]);
+            if (candidate == 0) break;
+            bound = candidate - 1;
+        }
+        return results;
+    }
+
+    const std::string& Name(uint32_t id) const { return names[id]; }
+    size_t Size() const { return entries.size(); }
+
+private:
+    // Newest-first union of the posting lists of every token that starts
+    // with a prefix, merged lazily so short prefixes cost only what is read.
+    class PrefixCursor {
+    public:
+        void AddList(const std::vector<uint32_t>& list) {
+            heap.push({ list.back(), lists.size() });
+            lists.push_back({ &list, list.size() });
+        }
+
+        // Largest matching id <= bound; false once the term is exhausted
+        bool Seek(uint32_t bound, uint32_t& id) {
+            while (!heap.empty() && heap.top().first > bound) {
+                size_t i = heap.top().second;
+                heap.pop();
+                List& list = lists[i];
+                auto begin = list.postings->begin();
+                list.end = upper_bound(begin, begin + list.end, bound) - begin;
+                if (list.end > 0) heap.push({ (*list.postings)[list.end - 1], i });
+            }
+            if (heap.empty()) return false;
+            id = heap.top().first;
+            return true;
+        }
+
+    private:
+        struct List {
+            const std::vector<uint32_t>* postings;
+            size_t end;  // postings[0, end) are still unread
+        };
+        std::vector<List> lists;
+        std::priority_queue<std::pair<uint32_t, size_t>> heap;  // (next id, list)
+    };
+
+    static void AddPosting(std::vector<uint32_t>& postings, uint32_t id) {
+        // Ids only grow, so a repeated word in one message is always at the back
+        if (postings.empty() || postings.back() != id)
+            postings.push_back(id);
+    }
+
+    static uint64_t Key(uint32_t conversationId, uint32_t tokenId) {
+        return ((uint64_t)conversationId << 32) | tokenId;
+    }
+
+    // Adding hashes the word; the sorted copy is only touched for new words
+    uint32_t InternToken(const std::string& token) {
+        auto inserted = tokenIds.insert({ token, (uint32_t)postings.size() });
+        if (inserted.second) {
+            postings.emplace_back();
+            sortedTokens.insert({ token, inserted.first->second });
+        }
+        return inserted.first->second;
+    }
+
+    static std::string Lower(const std::string& text) {
+        std::string lower = text;
+        for (char& c : lower) c = (char)tolower((unsigned char)c);
+        return lower;
+    }
+
+    // Usernames are case-insensitive; the first spelling seen is displayed
+    uint32_t Intern(const std::string& name) {
+        auto inserted = nameIds.insert({ Lower(name), (uint32_t)names.size() });
+        if (inserted.second) names.push_back(name);
+        return inserted.first->second;
+    }
+
+    std::vector<HistoryEntry> entries;
+    std::vector<std::string> names;
+    std::map<std::string, uint32_t> nameIds;  // lowercased name -> id
+    std::unordered_map<std::string, uint32_t> tokenIds;
+    std::map<std::string, uint32_t> sortedTokens;                       // for prefix lookups
+    std::vector<std::vector<uint32_t>> postings;                         // by token id
+    std::unordered_map<uint64_t, std::vector<uint32_t>> conversationPostings;  // (conversation, token)
+};
@@ -0,0 +1,86 @@
+// history_search_bench.cpp - Timing check for HistoryIndex over 1M synthetic messages
+//   g++ -O2 -std=c++17 history_search_bench.cpp -o history_search_bench
+#include "history_index.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+const size_t MESSAGE_COUNT = 1000000;
+const size_t CONVERSATION_COUNT = 200;
+const size_t VOCABULARY_SIZE = 50000;
+const size_t WORDS_PER_MESSAGE = 12;
+const size_t RESULT_LIMIT = 50;
+const double BUDGET_MS = 10.0;
+
+double ElapsedMs(Clock::time_point start) {
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+int main() {
+    mt19937 rng(42);
+
+    // Random lowercase words, drawn with a Zipf-like skew like real chat
+    vector<string> vocabulary;
+    uniform_int_distribution<int> letter('a', 'z');
+    uniform_int_distribution<int> wordLength(2, 9);
+    for (size_t i = 0; i < VOCABULARY_SIZE; i++) {
+        string word;
+        for (int n = wordLength(rng); n > 0; n--) word += (char)letter(rng);
+        vocabulary.push_back(word);
+    }
+    vector<double> weights;
+    for (size_t i = 0; i < VOCABULARY_SIZE; i++) weights.push_back(1.0 / (i + 1));
+    discrete_distribution<size_t> pickWord(weights.begin(), weights.end());
+    uniform_int_distribution<size_t> pickConversation(0, CONVERSATION_COUNT - 1);
+
+    HistoryIndex index;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < MESSAGE_COUNT; i++) {
+        string text;
+        for (size_t w = 0; w < WORDS_PER_MESSAGE; w++) {
+            if (w) text += ' ';
+            text += vocabulary[pickWord(rng)];
+        }
+        string conversation = "user" + to_string(pickConversation(rng));
+        index.Add(conversation, (i % 2) ? conversation : "me", text);
+    }
+    printf("indexed %zu messages in %.0f ms\n", index.Size(), ElapsedMs(start));
+
+    struct Query {
+        string text;
+        string conversation;
+    };
+    vector<Query> queries = {
+        { vocabulary[0], "" },
+        { vocabulary[0].substr(0, 1), "" },
+        { vocabulary[0].substr(0, 1), "user7" },
+        { vocabulary[1] + " " + vocabulary[2], "" },
+        { vocabulary[1] + " " + vocabulary[2], "user7" },
+        { vocabulary[VOCABULARY_SIZE - 1], "" },
+        { vocabulary[10].substr(0, 2) + " " + vocabulary[20].substr(0, 2), "user42" },
+        { "zzzzzzzzzz", "" },
+    };
+
+    bool withinBudget = true;
+    for (const Query& query : queries) {
+        start = Clock::now();
+        size_t found = index.Search(query.text, query.conversation, RESULT_LIMIT).size();
+        double ms = ElapsedMs(start);
+        withinBudget = withinBudget && ms <= BUDGET_MS;
+        printf("%-24s %-8s %3zu results %8.3f ms\n", query.text.c_str(),
+               query.conversation.empty() ? "(all)" : query.conversation.c_str(), found, ms);
+    }
+
+    if (!withinBudget) {
+        printf("FAIL: a query took longer than %.0f ms\n", BUDGET_MS);
+        return 1;
+    }
+    printf("OK: every query under %.0f ms\n", BUDGET_MS);
+    return 0;
+}